@@ -0,0 +1,125 @@
+#include "bufpool.hpp"
+
+namespace x_company::xkdbmes {
+
+struct BufferPool::local_cache {
+  std::array<std::vector<streambuf_ptr>, NCLASSES> bufs;
+
+  // thread exits, hand cached buffers over to the shared pool
+  ~local_cache() {
+    auto &pool = BufferPool::instance();
+    for (size_t cls = 0; cls < NCLASSES; cls++) {
+      for (auto &sb : bufs[cls]) {
+        pool.idle_--;
+        pool.idle_bytes_ -= sb->capacity();
+        pool.put_(cls, std::move(sb));
+      }
+    }
+  }
+};
+
+BufferPool &BufferPool::instance() {
+  static BufferPool pool;
+  return pool;
+}
+
+BufferPool::local_cache &BufferPool::local_() {
+  thread_local local_cache cache;
+  return cache;
+}
+
+size_t BufferPool::size_class(size_t capacity) {
+  for (size_t cls = 0; cls < NCLASSES; cls++) {
+    if (capacity <= MIN_SIZE << (2 * cls)) {
+      return cls;
+    }
+  }
+  return NCLASSES;
+}
+
+streambuf_ptr BufferPool::acquire() {
+  streambuf_ptr sb;
+  auto &local = local_();
+  for (size_t cls = 0; cls < NCLASSES && !sb; cls++) {
+    sb = take_(local.bufs[cls]);
+  }
+  if (!sb) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (size_t cls = 0; cls < NCLASSES && !sb; cls++) {
+      sb = take_(shared_[cls]);
+    }
+  }
+
+  if (sb) {
+    hits_++;
+    idle_--;
+    idle_bytes_ -= sb->capacity();
+  } else {
+    misses_++;
+    sb = std::make_unique<boost::asio::streambuf>();
+  }
+  in_use_++;
+  return sb;
+}
+
+void BufferPool::release(streambuf_ptr sb) {
+  if (!sb) {
+    return;
+  }
+  in_use_--;
+  sb->consume(sb->size());
+
+  auto cls = size_class(sb->capacity());
+  if (cls == NCLASSES) {
+    dropped_++;
+    return;
+  }
+
+  auto &local = local_();
+  if (local.bufs[cls].size() < LOCAL_CACHE) {
+    idle_++;
+    idle_bytes_ += sb->capacity();
+    local.bufs[cls].push_back(std::move(sb));
+  } else {
+    put_(cls, std::move(sb));
+  }
+}
+
+buffer_pool_stats BufferPool::stats() const {
+  buffer_pool_stats s;
+  s.in_use = in_use_;
+  s.idle = idle_;
+  s.idle_bytes = idle_bytes_;
+  s.hits = hits_;
+  s.misses = misses_;
+  s.dropped = dropped_;
+  return s;
+}
+
+streambuf_ptr BufferPool::take_(std::vector<streambuf_ptr> &bufs) {
+  streambuf_ptr sb;
+  if (!bufs.empty()) {
+    sb = std::move(bufs.back());
+    bufs.pop_back();
+  }
+  return sb;
+}
+
+void BufferPool::put_(size_t cls, streambuf_ptr sb) {
+  auto capacity = sb->capacity();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if ((shared_[cls].size() + 1) * (MIN_SIZE << (2 * cls)) <= SHARED_BYTES) {
+      shared_[cls].push_back(std::move(sb));
+    }
+  }
+
+  if (sb) {
+    dropped_++;
+  } else {
+    idle_++;
+    idle_bytes_ += capacity;
+  }
+}
+
+} // namespace x_company::xkdbmes
@@ -0,0 +1,90 @@
+// "Copyright 2021 Kirill Konevets"
+
+/**
+ *   \file bufpool.hpp
+ *   \brief Shared pool of connection stream buffers bucketed by size class
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <boost/asio.hpp>
+#include <boost/core/noncopyable.hpp>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace x_company::xkdbmes {
+
+using streambuf_ptr = std::unique_ptr<boost::asio::streambuf>;
+
+/**
+ *  \brief Buffer pool usage counters
+ */
+struct buffer_pool_stats {
+  size_t in_use = 0;     // buffers borrowed by connections
+  size_t idle = 0;       // buffers cached in the pool
+  size_t idle_bytes = 0; // capacity of cached buffers
+  size_t hits = 0;       // acquires served from the pool
+  size_t misses = 0;     // acquires that allocated a new buffer
+  size_t dropped = 0;    // released buffers freed instead of cached
+};
+
+/**
+ *  \brief Process wide pool of stream buffers. Connections borrow a buffer
+ * while a message is in flight and give it back when idle, so mostly idle
+ * connections hold no memory. Buffers are cached by capacity in size classes,
+ * each thread keeps a small cache in front of the shared one. Buffers that
+ * outgrow the largest class are freed on release. Thread safe.
+ */
+class BufferPool : boost::noncopyable {
+public:
+  // size of class `i` is MIN_SIZE << (2 * i)
+  static constexpr size_t MIN_SIZE = 4096;
+  static constexpr size_t NCLASSES = 5;
+  // per class limits of cached buffers
+  static constexpr size_t LOCAL_CACHE = 8;
+  static constexpr size_t SHARED_BYTES = 16 << 20;
+
+  static BufferPool &instance();
+
+  /**
+   *  \brief Borrow an empty buffer, the smallest cached one if any
+   */
+  streambuf_ptr acquire();
+
+  /**
+   *  \brief Give an empty buffer back to the pool
+   */
+  void release(streambuf_ptr sb);
+
+  buffer_pool_stats stats() const;
+
+  /**
+   *  \brief Size class of a buffer with `capacity` bytes, NCLASSES if it does
+   * not fit any
+   */
+  static size_t size_class(size_t capacity);
+
+private:
+  struct local_cache;
+
+  BufferPool() = default;
+
+  static streambuf_ptr take_(std::vector<streambuf_ptr> &bufs);
+  void put_(size_t cls, streambuf_ptr sb);
+  local_cache &local_();
+
+  std::array<std::vector<streambuf_ptr>, NCLASSES> shared_;
+  mutable std::mutex mutex_;
+
+  std::atomic<size_t> in_use_{0};
+  std::atomic<size_t> idle_{0};
+  std::atomic<size_t> idle_bytes_{0};
+  std::atomic<size_t> hits_{0};
+  std::atomic<size_t> misses_{0};
+  std::atomic<size_t> dropped_{0};
+};
+
+} // namespace x_company::xkdbmes
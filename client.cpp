@@ -19,12 +19,15 @@ xkdb::Response Client::exec(const Message &query) {
   xkdb::Response resp;
 
   if (!dstream_.serialize(query, resp)) {
+    dstream_.release();
     return resp;
   }
-  boost::asio::write(socket_, dstream_.buf());
+  boost::asio::write(socket_, dstream_.obuf());
   auto length =
-      boost::asio::read_until(socket_, dstream_.buf(), DelimitedStream::DELIM);
+      boost::asio::read_until(socket_, dstream_.ibuf(), DelimitedStream::DELIM);
   dstream_.parse(resp, resp, length);
+  // don't hold a buffer between queries
+  dstream_.release();
   return resp;
 }
 
@@ -86,7 +89,7 @@ void AsynClient::write_(const Message &query) {
     throw std::runtime_error(resp.emsg());
   }
   boost::asio::async_write( //
-      socket_, dstream_.buf(),
+      socket_, dstream_.obuf(),
       [this, self](boost::system::error_code ec, std::size_t) {
         if (!ec) {
           read_();
@@ -100,7 +103,7 @@ void AsynClient::write_(const Message &query) {
 void AsynClient::read_() {
   auto self(shared_from_this());
   boost::asio::async_read_until(
-      socket_, dstream_.buf(), DelimitedStream::DELIM,
+      socket_, dstream_.ibuf(), DelimitedStream::DELIM,
       [this, self](boost::system::error_code ec, std::size_t length) {
         if (!ec) {
           xkdb::Response resp;
@@ -108,6 +111,8 @@ void AsynClient::read_() {
             stop();
             throw std::runtime_error(resp.emsg());
           }
+          // don't hold a buffer between queries
+          dstream_.release();
           if (!connected_) {
             // first response is always auth response
             if (resp.status() == xkdb::Response::OK) {
@@ -7,25 +7,64 @@ std::string streambuf_copy(boost::asio::streambuf &sb, size_t length) {
                      boost::asio::buffers_begin(sb.data()) + length);
 }
 
+boost::asio::streambuf &DelimitedStream::borrow_(streambuf_ptr &sb) {
+  if (!sb) {
+    sb = BufferPool::instance().acquire();
+  }
+  return *sb;
+}
+
+void DelimitedStream::release() {
+  for (auto sb : {&isb_, &osb_}) {
+    if (*sb && (*sb)->size() == 0) {
+      BufferPool::instance().release(std::move(*sb));
+    }
+  }
+}
+
 bool DelimitedStream::serialize(const Message &query, xkdb::Response &resp) {
-  bool success = query.SerializeToOstream(&os_);
+  std::ostream os(&obuf());
+  bool success = query.SerializeToOstream(&os);
   if (!success) {
     resp.Clear();
     resp.set_status(error_status_);
     resp.set_emsg(std::string("could not serialize ") + typeid(query).name());
   } else {
-    os_ << DELIM;
+    os << DELIM;
   }
   return success;
 }
 
 bool DelimitedStream::parse(Message &query, xkdb::Response &resp,
                             size_t length) {
-  // get next `length` bytes from a scoket excluding delimiter
-  auto subs = streambuf_copy(sb_, length - DELIM.size());
+  // parse next `length` bytes from a scoket excluding delimiter, streambuf
+  // data is contiguous so no need to copy it out
+  auto data = ibuf().data();
+  bool success = query.ParseFromArray(data.data(), length - DELIM.size());
   // Consume through the first delimiter.
-  sb_.consume(length);
-  bool success = query.ParseFromString(subs);
+  ibuf().consume(length);
+  if (!success) {
+    resp.Clear();
+    resp.set_status(error_status_);
+    resp.set_emsg(std::string("could not parse ") + typeid(query).name());
+  }
+  return success;
+}
+
+bool DelimitedStream::parse(Message &query, xkdb::Response &resp,
+                            size_t length, std::shared_ptr<Frame> &frame) {
+  // pipelined data past the delimiter moves on to a buffer of its own
+  streambuf_ptr rest;
+  if (ibuf().size() > length) {
+    rest = BufferPool::instance().acquire();
+    auto data = isb_->data();
+    rest->commit(boost::asio::buffer_copy(rest->prepare(data.size() - length),
+                                          data + length));
+  }
+  // the received buffer itself becomes the frame, stream borrows a new one
+  frame = std::make_shared<Frame>(std::move(isb_), length - DELIM.size());
+  isb_ = std::move(rest);
+  bool success = frame->parse(query);
   if (!success) {
     resp.Clear();
     resp.set_status(error_status_);
@@ -9,9 +9,13 @@
 
 #include <boost/asio.hpp>
 #include <boost/asio/write.hpp>
+#include <boost/core/noncopyable.hpp>
 #include <google/protobuf/message.h>
+#include <memory>
 #include <string>
 
+#include "bufpool.hpp"
+#include "frame.hpp"
 #include <xkdb.pb.h>
 
 using Message = google::protobuf::Message;
@@ -26,9 +30,12 @@ namespace x_company::xkdbmes {
 std::string streambuf_copy(boost::asio::streambuf &sb, size_t length);
 
 /**
- *  \brief Incapsulates socket io with a delimiter
+ *  \brief Incapsulates socket io with a delimiter. Received and outgoing
+ * data have separate stream buffers, so a reply never mixes with pipelined
+ * input. Buffers are borrowed from `BufferPool` on first use and given back
+ * by `release()`
  */
-class DelimitedStream {
+class DelimitedStream : boost::noncopyable {
 public:
   static constexpr std::string_view DELIM = "==DELIM==";
 
@@ -38,8 +45,13 @@ public:
   explicit DelimitedStream(xkdb::Response::Status error_status)
       : error_status_(error_status) {}
 
+  ~DelimitedStream() {
+    BufferPool::instance().release(std::move(isb_));
+    BufferPool::instance().release(std::move(osb_));
+  }
+
   /**
-   *  \brief Serialize query into socket ostream and add delimiter
+   *  \brief Serialize query into outgoing buffer and add delimiter
    *
    *  \return true if serialized sucessfully, otherwise sets response status and
    * error message
@@ -47,7 +59,7 @@ public:
   bool serialize(const Message &query, xkdb::Response &resp);
 
   /**
-   *  \brief Parse query from socket delimited istream
+   *  \brief Parse query from received buffer
    *
    *  \param length The number of bytes in the streambuf's get area up to and
    * including the delimiter
@@ -57,14 +69,38 @@ public:
   bool parse(Message &query, xkdb::Response &resp, size_t length);
 
   /**
-   *  Get socket stream buffer
+   *  \brief Same as above, but hands the received buffer over to `frame` and
+   * leaves large string/bytes fields there instead of copying them into
+   * `query`
+   */
+  bool parse(Message &query, xkdb::Response &resp, size_t length,
+             std::shared_ptr<Frame> &frame);
+
+  /**
+   *  Get buffer of received data, borrow one from the pool if not holding any
+   */
+  boost::asio::streambuf &ibuf() { return borrow_(isb_); }
+
+  /**
+   *  Get buffer of outgoing data, borrow one from the pool if not holding any
    */
-  boost::asio::streambuf &buf() { return sb_; }
+  boost::asio::streambuf &obuf() { return borrow_(osb_); }
+
+  /**
+   *  \brief Give buffers back to the pool unless there is data left in them
+   */
+  void release();
+
+  /**
+   *  \brief Checks if received data is left after parsed messages
+   */
+  bool pending() const { return isb_ && isb_->size() > 0; }
 
 private:
-  boost::asio::streambuf sb_;
-  std::istream is_{&sb_};
-  std::ostream os_{&sb_};
+  static boost::asio::streambuf &borrow_(streambuf_ptr &sb);
+
+  streambuf_ptr isb_;
+  streambuf_ptr osb_;
   xkdb::Response::Status error_status_;
 };
 
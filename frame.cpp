@@ -0,0 +1,221 @@
+#include "frame.hpp"
+
+#include <google/protobuf/io/coded_stream.h>
+#include <algorithm>
+#include <google/protobuf/wire_format_lite.h>
+#include <stdexcept>
+
+namespace x_company::xkdbmes {
+
+using google::protobuf::io::CodedInputStream;
+using google::protobuf::internal::WireFormatLite;
+
+// same as protobuf's default recursion limit
+static constexpr int MAX_DEPTH = 100;
+
+static void append_varint(std::string &out, uint64_t value) {
+  while (value >= 0x80) {
+    out.push_back(static_cast<char>(value | 0x80));
+    value >>= 7;
+  }
+  out.push_back(static_cast<char>(value));
+}
+
+// members of a oneof replace each other, so they share a key
+static const void *ref_key(const FieldDescriptor *fd) {
+  if (auto oneof = fd->containing_oneof()) {
+    return oneof;
+  }
+  return fd;
+}
+
+Frame::Frame(std::string bytes) : owned_(std::move(bytes)), bytes_(owned_) {}
+
+Frame::Frame(streambuf_ptr sb, size_t length)
+    : sb_(std::move(sb)),
+      bytes_(static_cast<const char *>(sb_->data().data()), length) {}
+
+void Frame::replace_oneof_(refs_t &refs, const path_t &path,
+                           const FieldDescriptor *fd) {
+  auto oneof = fd->containing_oneof();
+  refs.erase({path, oneof});
+
+  for (int i = 0; i < oneof->field_count(); i++) {
+    auto other = oneof->field(i);
+    if (other == fd || other->cpp_type() != FieldDescriptor::CPPTYPE_MESSAGE) {
+      continue;
+    }
+    // views inside a submessage have its path as a prefix and sort together
+    auto prefix = path;
+    prefix.emplace_back(other->number(), 0);
+    auto it = refs.lower_bound({prefix, nullptr});
+    while (it != refs.end() && it->first.first.size() >= prefix.size() &&
+           std::equal(prefix.begin(), prefix.end(), it->first.first.begin())) {
+      it = refs.erase(it);
+    }
+  }
+}
+
+bool Frame::strip_(std::string_view data,
+                   const google::protobuf::Descriptor *desc,
+                   const path_t &path, size_t threshold, int depth,
+                   refs_t &refs, std::string &out) const {
+  if (depth > MAX_DEPTH) {
+    return false;
+  }
+
+  CodedInputStream in(reinterpret_cast<const uint8_t *>(data.data()),
+                      static_cast<int>(data.size()));
+  // number of parsed values of repeated message fields
+  std::map<int, int> counts;
+
+  while (true) {
+    auto begin = in.CurrentPosition();
+    auto tag = in.ReadTag();
+    if (tag == 0) {
+      // end of message or a malformed tag
+      return in.CurrentPosition() == static_cast<int>(data.size());
+    }
+    auto fd = desc->FindFieldByNumber(WireFormatLite::GetTagFieldNumber(tag));
+    auto wire_type = WireFormatLite::GetTagWireType(tag);
+
+    if (!fd || wire_type != WireFormatLite::WIRETYPE_LENGTH_DELIMITED) {
+      if (!WireFormatLite::SkipField(&in, tag)) {
+        return false;
+      }
+      if (fd && fd->containing_oneof()) {
+        auto type = static_cast<WireFormatLite::FieldType>(fd->type());
+        if (wire_type == WireFormatLite::WireTypeForFieldType(type)) {
+          replace_oneof_(refs, path, fd);
+        }
+      }
+      out.append(data.substr(begin, in.CurrentPosition() - begin));
+      continue;
+    }
+
+    auto tag_end = in.CurrentPosition();
+    uint32_t length;
+    if (!in.ReadVarint32(&length) ||
+        length > data.size() - in.CurrentPosition()) {
+      return false;
+    }
+    auto value = data.substr(in.CurrentPosition(), length);
+    in.Skip(length);
+    if (fd->containing_oneof()) {
+      replace_oneof_(refs, path, fd);
+    }
+
+    if ((fd->type() == FieldDescriptor::TYPE_STRING ||
+         fd->type() == FieldDescriptor::TYPE_BYTES) &&
+        !fd->is_repeated() && length >= threshold) {
+      refs[{path, ref_key(fd)}] = {path, fd, value};
+      continue;
+    }
+
+    // the last occurrence wins, drop a pending view it replaces
+    if (!fd->is_repeated()) {
+      refs.erase({path, ref_key(fd)});
+    }
+
+    if (fd->type() == FieldDescriptor::TYPE_MESSAGE && !fd->is_map()) {
+      auto subpath = path;
+      subpath.emplace_back(fd->number(),
+                           fd->is_repeated() ? counts[fd->number()]++ : 0);
+      std::string sub;
+      if (!strip_(value, fd->message_type(), subpath, threshold, depth + 1,
+                  refs, sub)) {
+        return false;
+      }
+      out.append(data.substr(begin, tag_end - begin));
+      append_varint(out, sub.size());
+      out.append(sub);
+    } else {
+      out.append(data.substr(begin, in.CurrentPosition() - begin));
+    }
+  }
+}
+
+bool Frame::initialized_(const Message &msg) const {
+  auto desc = msg.GetDescriptor();
+  auto refl = msg.GetReflection();
+  for (int i = 0; i < desc->field_count(); i++) {
+    auto fd = desc->field(i);
+    if (fd->is_required() && !refl->HasField(msg, fd) &&
+        !views_.count({&msg, fd})) {
+      return false;
+    }
+    if (fd->cpp_type() != FieldDescriptor::CPPTYPE_MESSAGE) {
+      continue;
+    }
+    if (fd->is_repeated()) {
+      for (int j = 0; j < refl->FieldSize(msg, fd); j++) {
+        if (!initialized_(refl->GetRepeatedMessage(msg, fd, j))) {
+          return false;
+        }
+      }
+    } else if (refl->HasField(msg, fd) &&
+               !initialized_(refl->GetMessage(msg, fd))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool Frame::parse(Message &msg, size_t threshold) {
+  views_.clear();
+
+  refs_t refs;
+  std::string stripped;
+  stripped.reserve(bytes_.size());
+  if (!strip_(bytes_, msg.GetDescriptor(), {}, threshold, 0, refs,
+              stripped)) {
+    return false;
+  }
+  // nothing to leave in place, parse the frame as is
+  if (refs.empty()) {
+    return msg.ParseFromArray(bytes_.data(), static_cast<int>(bytes_.size()));
+  }
+  if (!msg.ParsePartialFromString(stripped)) {
+    return false;
+  }
+
+  // bind views to the submessages they belong to
+  for (auto &[key, ref] : refs) {
+    Message *m = &msg;
+    for (auto [number, index] : ref.path) {
+      auto fd = m->GetDescriptor()->FindFieldByNumber(number);
+      auto refl = m->GetReflection();
+      m = fd->is_repeated() ? refl->MutableRepeatedMessage(m, fd, index)
+                            : refl->MutableMessage(m, fd);
+    }
+    // an earlier small occurrence was parsed, the view replaces it
+    if (auto oneof = ref.fd->containing_oneof()) {
+      m->GetReflection()->ClearOneof(m, oneof);
+    } else {
+      m->GetReflection()->ClearField(m, ref.fd);
+    }
+    views_[{m, ref.fd}] = ref.value;
+  }
+  return msg.IsInitialized() || initialized_(msg);
+}
+
+std::string_view Frame::get(const Message &msg,
+                            const FieldDescriptor *fd) const {
+  if (auto it = views_.find({&msg, fd}); it != views_.end()) {
+    return it->second;
+  }
+  return msg.GetReflection()->GetStringReference(msg, fd, &scratch_);
+}
+
+std::string_view Frame::get(const Message &msg,
+                            const std::string &name) const {
+  auto fd = msg.GetDescriptor()->FindFieldByName(name);
+  if (!fd || fd->is_repeated() ||
+      fd->cpp_type() != FieldDescriptor::CPPTYPE_STRING) {
+    throw std::invalid_argument("no singular string field " + name + " in " +
+                                msg.GetDescriptor()->full_name());
+  }
+  return get(msg, fd);
+}
+
+} // namespace x_company::xkdbmes
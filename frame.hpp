@@ -0,0 +1,116 @@
+// "Copyright 2021 Kirill Konevets"
+
+/**
+ *   \file frame.hpp
+ *   \brief Received message bytes with zero-copy views of large fields
+ */
+
+#pragma once
+
+#include <boost/core/noncopyable.hpp>
+#include <google/protobuf/descriptor.h>
+#include <google/protobuf/message.h>
+#include <map>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "bufpool.hpp"
+
+using Message = google::protobuf::Message;
+using FieldDescriptor = google::protobuf::FieldDescriptor;
+
+namespace x_company::xkdbmes {
+
+/**
+ *  \brief Owns the bytes of one received message, usually the very stream
+ * buffer it was received into. Singular string/bytes fields of at least
+ * `threshold` bytes are not copied into the parsed message, they are left
+ * unset there and exposed as views into the frame instead. The frame must
+ * outlive the parsed message's use of `get()`.
+ *
+ * The frame is walked once, compacting small fields into a temporary
+ * buffer. A message without large fields is then parsed straight from the
+ * frame, otherwise from the compacted buffer, so small fields are copied
+ * twice.
+ */
+class Frame : boost::noncopyable {
+public:
+  static constexpr size_t VIEW_THRESHOLD = 256;
+
+  /**
+   *  \brief Frame over its own copy of message bytes
+   */
+  explicit Frame(std::string bytes);
+
+  /**
+   *  \brief Frame over the first `length` bytes of a pooled buffer, the
+   * buffer goes back to the pool when the frame is destroyed
+   */
+  Frame(streambuf_ptr sb, size_t length);
+
+  ~Frame() { BufferPool::instance().release(std::move(sb_)); }
+
+  /**
+   *  \brief Parse frame bytes into `msg` leaving large fields in place. As in
+   * protobuf parsing the last occurrence of a singular field wins.
+   *  \return true if parsed sucessfully and all required fields are set,
+   * either in `msg` or as views
+   */
+  bool parse(Message &msg, size_t threshold = VIEW_THRESHOLD);
+
+  /**
+   *  \brief Value of a string/bytes field of `msg` or of its submessage,
+   * either a view into the frame or the field stored in the message
+   */
+  std::string_view get(const Message &msg, const FieldDescriptor *fd) const;
+
+  /**
+   *  \brief Same as above with a field looked up by name
+   */
+  std::string_view get(const Message &msg, const std::string &name) const;
+
+  /**
+   *  \brief Raw message bytes
+   */
+  std::string_view bytes() const { return bytes_; }
+
+private:
+  // (field number, index among repeated values) from the root message
+  using path_t = std::vector<std::pair<int, int>>;
+
+  struct view_ref {
+    path_t path;
+    const FieldDescriptor *fd;
+    std::string_view value;
+  };
+
+  // pending views by path and field, or by oneof for oneof members, so that a
+  // later occurrence replaces an earlier one
+  using refs_t = std::map<std::pair<path_t, const void *>, view_ref>;
+
+  // collect large fields of a message into `refs` and copy the rest of its
+  // wire data to `out`
+  bool strip_(std::string_view data, const google::protobuf::Descriptor *desc,
+              const path_t &path, size_t threshold, int depth, refs_t &refs,
+              std::string &out) const;
+
+  // an occurrence of oneof member `fd` replaces the oneof value, drop pending
+  // views of the oneof and views inside its other members
+  static void replace_oneof_(refs_t &refs, const path_t &path,
+                             const FieldDescriptor *fd);
+
+  // same as `IsInitialized()` but a required field may be a view
+  bool initialized_(const Message &msg) const;
+
+  std::string owned_;
+  streambuf_ptr sb_;
+  std::string_view bytes_;
+  std::map<std::pair<const Message *, const FieldDescriptor *>,
+           std::string_view>
+      views_;
+  mutable std::string scratch_;
+};
+
+} // namespace x_company::xkdbmes
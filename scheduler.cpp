@@ -0,0 +1,126 @@
+#include "scheduler.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace x_company::xkdbmes {
+
+Scheduler::Scheduler(boost::asio::io_context &ioc, sched_config config)
+    : ioc_(ioc), config_(std::move(config)), states_(config_.classes.size()) {
+  auto nclasses = config_.classes.size();
+  auto valid = [nclasses](const auto &route) {
+    return route.second < nclasses;
+  };
+  if (config_.default_class >= nclasses ||
+      !std::all_of(config_.by_type.begin(), config_.by_type.end(), valid) ||
+      !std::all_of(config_.by_user.begin(), config_.by_user.end(), valid)) {
+    throw std::invalid_argument("scheduler: class index out of range");
+  }
+
+  for (size_t i = 0; i < nclasses; i++) {
+    order_.push_back(i);
+  }
+  std::stable_sort(order_.begin(), order_.end(), [this](size_t a, size_t b) {
+    return config_.classes[a].priority < config_.classes[b].priority;
+  });
+}
+
+size_t Scheduler::classify(const xkdb::Query &query,
+                           const connection_info &info) const {
+  if (auto it = config_.by_user.find(info.user); it != config_.by_user.end()) {
+    return it->second;
+  }
+  if (auto it = config_.by_type.find(query.type());
+      it != config_.by_type.end()) {
+    return it->second;
+  }
+  return config_.default_class;
+}
+
+size_t Scheduler::pending() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  size_t n = 0;
+  for (auto &st : states_) {
+    n += st.queued;
+  }
+  return n;
+}
+
+void Scheduler::submit(const xkdb::Query &query, const connection_info &info,
+                       task_t task) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto &st = states_[classify(query, info)];
+
+  unsigned weight = 1;
+  if (auto it = config_.weights.find(info.user);
+      it != config_.weights.end() && it->second > 0) {
+    weight = it->second;
+  }
+
+  auto &f = st.flows[info.user];
+  auto tag = std::max(st.vtime, f.last_tag) + 1.0 / weight;
+  f.last_tag = tag;
+  if (f.jobs.empty()) {
+    st.ready.emplace(tag, info.user);
+  }
+  f.jobs.push_back({tag, std::move(task)});
+  st.queued++;
+
+  dispatch_();
+}
+
+void Scheduler::dispatch_() {
+  bool dispatched = true;
+  while (dispatched) {
+    dispatched = false;
+    for (auto cls : order_) {
+      if (config_.max_concurrent && running_ >= config_.max_concurrent) {
+        return;
+      }
+      auto &st = states_[cls];
+      auto cap = config_.classes[cls].max_concurrent;
+      if (st.ready.empty() || (cap && st.running >= cap)) {
+        continue;
+      }
+
+      // take the head job of a flow with the least virtual finish time
+      auto user = st.ready.begin()->second;
+      st.ready.erase(st.ready.begin());
+      auto &f = st.flows[user];
+      auto j = std::move(f.jobs.front());
+      f.jobs.pop_front();
+      st.vtime = j.tag;
+      if (!f.jobs.empty()) {
+        st.ready.emplace(f.jobs.front().tag, user);
+      } else {
+        st.flows.erase(user);
+      }
+
+      st.queued--;
+      st.running++;
+      running_++;
+      boost::asio::post(ioc_, [this, cls, task = std::move(j.task)] {
+        try {
+          task();
+        } catch (...) {
+          done_(cls);
+          throw;
+        }
+        done_(cls);
+      });
+
+      // start over from the highest priority class
+      dispatched = true;
+      break;
+    }
+  }
+}
+
+void Scheduler::done_(size_t cls) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  states_[cls].running--;
+  running_--;
+  dispatch_();
+}
+
+} // namespace x_company::xkdbmes
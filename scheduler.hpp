@@ -0,0 +1,112 @@
+// "Copyright 2021 Kirill Konevets"
+
+/**
+ *   \file scheduler.hpp
+ *   \brief Priority-aware scheduling of server queries by type and user
+ */
+
+#pragma once
+
+#include <boost/asio.hpp>
+#include <boost/core/noncopyable.hpp>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "../xkdb/common.hpp"
+#include <xkdb.pb.h>
+
+namespace x_company::xkdbmes {
+
+using query_type_t = decltype(std::declval<xkdb::Query>().type());
+
+/**
+ *  \brief Priority class of queries
+ */
+struct sched_class {
+  int priority = 0;          // lower value is dispatched first
+  size_t max_concurrent = 0; // cap on running handlers, 0 means unlimited
+};
+
+/**
+ *  \brief Scheduler configuration. Classes are referred to by index in
+ * `classes`, a user route takes precedence over a query type route.
+ */
+struct sched_config {
+  std::vector<sched_class> classes{sched_class{}};
+  size_t default_class = 0;
+  std::map<query_type_t, size_t> by_type;
+  std::map<std::string, size_t> by_user;
+  // weighted fair queuing across users inside a class, default weight is 1
+  std::map<std::string, unsigned> weights;
+  // cap on running handlers of all classes, 0 means unlimited
+  size_t max_concurrent = 0;
+};
+
+/**
+ *  \brief Queues queries into priority classes and dispatches them to
+ * io_context. Inside a class users are served by weighted fair queuing.
+ * Thread safe.
+ */
+class Scheduler : boost::noncopyable {
+public:
+  using task_t = std::function<void()>;
+
+  Scheduler(boost::asio::io_context &ioc, sched_config config);
+
+  /**
+   *  \brief Enqueue a task that handles `query`, it is posted to io_context
+   * when its class and the scheduler have free slots
+   */
+  void submit(const xkdb::Query &query, const connection_info &info,
+              task_t task);
+
+  /**
+   *  \brief Class index of a query
+   */
+  size_t classify(const xkdb::Query &query, const connection_info &info) const;
+
+  /**
+   *  \brief Number of queued (not yet dispatched) tasks
+   */
+  size_t pending() const;
+
+private:
+  struct job {
+    double tag; // virtual finish time
+    task_t task;
+  };
+
+  struct flow {
+    std::deque<job> jobs;
+    double last_tag = 0;
+  };
+
+  struct class_state {
+    std::map<std::string, flow> flows;
+    // non empty flows ordered by virtual finish time of their head job
+    std::set<std::pair<double, std::string>> ready;
+    double vtime = 0;
+    size_t running = 0;
+    size_t queued = 0;
+  };
+
+  // post as many tasks as limits allow, must be called under lock
+  void dispatch_();
+  void done_(size_t cls);
+
+  boost::asio::io_context &ioc_;
+  const sched_config config_;
+  // class indices sorted by priority
+  std::vector<size_t> order_;
+  std::vector<class_state> states_;
+  size_t running_{0};
+  mutable std::mutex mutex_;
+};
+
+} // namespace x_company::xkdbmes
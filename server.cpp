@@ -5,8 +5,31 @@ namespace x_company::xkdbmes {
 
 Server::Server(boost::asio::io_context &ioc, uint16_t port,
                auth_handle_t auth_handle, query_handle_t query_handle)
+    : Server(ioc, port, auth_handle, query_handle, nullptr, nullptr) {}
+
+Server::Server(boost::asio::io_context &ioc, uint16_t port,
+               auth_handle_t auth_handle, query_handle_t query_handle,
+               sched_config config)
+    : Server(ioc, port, auth_handle, query_handle, nullptr,
+             std::make_shared<Scheduler>(ioc, std::move(config))) {}
+
+Server::Server(boost::asio::io_context &ioc, uint16_t port,
+               auth_handle_t auth_handle, frame_query_handle_t query_handle)
+    : Server(ioc, port, auth_handle, nullptr, query_handle, nullptr) {}
+
+Server::Server(boost::asio::io_context &ioc, uint16_t port,
+               auth_handle_t auth_handle, frame_query_handle_t query_handle,
+               sched_config config)
+    : Server(ioc, port, auth_handle, nullptr, query_handle,
+             std::make_shared<Scheduler>(ioc, std::move(config))) {}
+
+Server::Server(boost::asio::io_context &ioc, uint16_t port,
+               auth_handle_t auth_handle, query_handle_t query_handle,
+               frame_query_handle_t frame_query_handle,
+               std::shared_ptr<Scheduler> scheduler)
     : acceptor_(ioc, tcp::endpoint(tcp::v4(), port)), auth_handle_(auth_handle),
-      query_handle_(query_handle) {
+      query_handle_(query_handle), frame_query_handle_(frame_query_handle),
+      scheduler_(std::move(scheduler)) {
   do_accept();
 }
 
@@ -14,7 +37,8 @@ void Server::do_accept() {
   acceptor_.async_accept([this](boost::system::error_code ec,
                                 tcp::socket socket) {
     if (!ec) {
-      std::make_shared<Session>(std::move(socket), auth_handle_, query_handle_)
+      std::make_shared<Session>(std::move(socket), auth_handle_, query_handle_,
+                                frame_query_handle_, scheduler_)
           ->start();
     }
     do_accept();
@@ -22,9 +46,12 @@ void Server::do_accept() {
 }
 
 Session::Session(tcp::socket socket, auth_handle_t auth_handle,
-                 query_handle_t query_handle)
+                 query_handle_t query_handle,
+                 frame_query_handle_t frame_query_handle,
+                 std::shared_ptr<Scheduler> scheduler)
     : socket_(std::move(socket)), auth_handle_(auth_handle),
-      query_handle_(query_handle) {
+      query_handle_(query_handle), frame_query_handle_(frame_query_handle),
+      scheduler_(std::move(scheduler)) {
   boost::system::error_code ec;
   auto remote = socket_.remote_endpoint(ec);
   if (!ec) {
@@ -39,35 +66,50 @@ Session::Session(tcp::socket socket, auth_handle_t auth_handle,
 }
 
 void Session::read_() {
+  if (dstream_.pending()) {
+    // pipelined data is already in the buffer
+    receive_();
+    return;
+  }
+
+  // wait for the next message without holding a buffer
+  auto self(shared_from_this());
+  socket_.async_wait(tcp::socket::wait_read,
+                     [this, self](boost::system::error_code ec) {
+                       if (!ec) {
+                         receive_();
+                       } else {
+                         XK_LOGERR << "xkdbmes wait error: " << ec.message()
+                                   << std::endl;
+                       }
+                     });
+}
+
+void Session::receive_() {
   auto self(shared_from_this());
   boost::asio::async_read_until(
-      socket_, dstream_.buf(), DelimitedStream::DELIM,
+      socket_, dstream_.ibuf(), DelimitedStream::DELIM,
       [this, self](boost::system::error_code ec, std::size_t length) {
         if (!ec) {
-          xkdb::Response resp;
-
           if (connected_) {
-            xkdb::Query query;
-            if (dstream_.parse(query, resp, length)) {
-              query_handle_(query, resp, info_);
+            handle_(length);
+            return;
+          }
+
+          xkdb::Response resp;
+          xkdb::Auth auth;
+          if (dstream_.parse(auth, resp, length)) {
+            if (auth_handle_(auth)) {
               resp.set_status(xkdb::Response::OK);
-            }
-          } else {
-            xkdb::Auth auth;
-            if (dstream_.parse(auth, resp, length)) {
-              if (auth_handle_(auth)) {
-                resp.set_status(xkdb::Response::OK);
-                info_.user = auth.user();
-                info_.auth = connected_ = true;
-              } else {
-                resp.set_status(xkdb::Response::UNAUTHORIZED);
-                resp.set_emsg("server: wrong user or password");
-              }
+              info_.user = auth.user();
+              info_.auth = connected_ = true;
+            } else {
+              resp.set_status(xkdb::Response::UNAUTHORIZED);
+              resp.set_emsg("server: wrong user or password");
             }
           }
 
-          dstream_.serialize(resp, resp);
-          write_();
+          reply_(resp);
         } else if (ec == boost::asio::error::eof) {
           ; // it's ok, client closed connection
         } else {
@@ -76,12 +118,54 @@ void Session::read_() {
       });
 }
 
+void Session::handle_(size_t length) {
+  auto self(shared_from_this());
+  auto query = std::make_shared<xkdb::Query>();
+  std::shared_ptr<Frame> frame;
+  xkdb::Response resp;
+
+  bool parsed = frame_query_handle_
+                    ? dstream_.parse(*query, resp, length, frame)
+                    : dstream_.parse(*query, resp, length);
+  if (!parsed) {
+    reply_(resp);
+    return;
+  }
+
+  // frame keeps field views alive till the query is handled
+  auto task = [this, self, query, frame] {
+    xkdb::Response resp;
+    if (frame_query_handle_) {
+      frame_query_handle_(*query, *frame, resp, info_);
+    } else {
+      query_handle_(*query, resp, info_);
+    }
+    resp.set_status(xkdb::Response::OK);
+    reply_(resp);
+  };
+
+  if (scheduler_) {
+    // reply when the scheduler gets to the query, don't hold a buffer while
+    // waiting
+    dstream_.release();
+    scheduler_->submit(*query, info_, std::move(task));
+  } else {
+    task();
+  }
+}
+
+void Session::reply_(xkdb::Response &resp) {
+  dstream_.serialize(resp, resp);
+  write_();
+}
+
 void Session::write_() {
   auto self(shared_from_this());
   boost::asio::async_write(
-      socket_, dstream_.buf(),
+      socket_, dstream_.obuf(),
       [this, self](boost::system::error_code ec, std::size_t /*length*/) {
         if (!ec) {
+          dstream_.release();
           read_();
         }
       });
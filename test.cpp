@@ -3,12 +3,20 @@
 #include <boost/asio.hpp>
 #include <boost/test/unit_test.hpp>
 #include <boost/thread.hpp>
+#include <atomic>
+#include <functional>
+#include <future>
 #include <iostream>
+#include <memory>
 #include <queue>
 #include <set>
 #include <string>
+#include <type_traits>
 #include <vector>
 
+#include <google/protobuf/descriptor.pb.h>
+#include <google/protobuf/dynamic_message.h>
+
 #include "xkdb.pb.h"
 #include "xkdbmes.hpp"
 
@@ -18,6 +26,10 @@ using Server = x_company::xkdbmes::Server;
 using Session = x_company::xkdbmes::Session;
 using Client = x_company::xkdbmes::Client;
 using AsynClient = x_company::xkdbmes::AsynClient;
+using Scheduler = x_company::xkdbmes::Scheduler;
+using BufferPool = x_company::xkdbmes::BufferPool;
+using Frame = x_company::xkdbmes::Frame;
+using DelimitedStream = x_company::xkdbmes::DelimitedStream;
 
 // colorful printing
 // yellow begin
@@ -52,6 +64,407 @@ auto query_handle(const xkdb::Query &query, xkdb::Response &resp,
   }
 }
 
+// echo event payloads read from the frame
+auto frame_query_handle(const xkdb::Query &query, const Frame &frame,
+                        xkdb::Response &resp,
+                        const x_company::connection_info & /*info*/) {
+  for (auto &qevent : query.events()) {
+    auto event = resp.add_events();
+    event->set_id(qevent.id());
+    event->set_extra(std::string(frame.get(qevent, "extra")));
+  }
+}
+
+// poll `done` for up to a second
+bool wait_for(const std::function<bool()> &done) {
+  for (int i = 0; i < 100 && !done(); i++) {
+    boost::this_thread::sleep_for(boost::chrono::milliseconds(10));
+  }
+  return done();
+}
+
+BOOST_AUTO_TEST_CASE(xkdb_scheduler) {
+  boost::asio::io_context ioc;
+
+  // bulk loader goes to a low priority class, one handler at a time
+  x_company::xkdbmes::sched_config config;
+  config.classes = {{0, 0}, {1, 0}};
+  config.by_user["loader"] = 1;
+  config.weights["heavy"] = 2;
+  config.max_concurrent = 1;
+  Scheduler scheduler(ioc, config);
+
+  std::vector<std::string> order;
+  auto submit = [&](const std::string &user) {
+    x_company::connection_info info;
+    info.user = user;
+    scheduler.submit(sample_query(0), info,
+                     [&order, user] { order.push_back(user); });
+  };
+
+  // first loader query is dispatched at once, the rest waits
+  submit("loader");
+  submit("loader");
+  submit("loader");
+  submit("light");
+  submit("light");
+  submit("heavy");
+  submit("heavy");
+  submit("heavy");
+  BOOST_TEST(scheduler.pending() == 7);
+
+  ioc.run();
+  BOOST_TEST(scheduler.pending() == 0);
+
+  // heavy gets twice the share of light, ties go to the lesser user name
+  std::vector<std::string> expected{"loader", "heavy", "heavy", "light",
+                                    "heavy",  "light", "loader", "loader"};
+  BOOST_TEST(order == expected, boost::test_tools::per_element());
+}
+
+BOOST_AUTO_TEST_CASE(xkdb_scheduler_class_cap) {
+  boost::asio::io_context ioc;
+  auto work = boost::asio::make_work_guard(ioc);
+  boost::thread_group tg;
+  for (int i = 0; i < 3; i++) {
+    tg.create_thread(boost::bind(&boost::asio::io_context::run, &ioc));
+  }
+
+  // loader is in a low priority class capped at one running handler
+  x_company::xkdbmes::sched_config config;
+  config.classes = {{0, 0}, {1, 1}};
+  config.by_user["loader"] = 1;
+  Scheduler scheduler(ioc, config);
+
+  x_company::connection_info loader, reader;
+  loader.user = "loader";
+  reader.user = "reader";
+
+  std::promise<void> release;
+  auto released = release.get_future().share();
+  std::atomic<int> low_started{0}, high_done{0};
+
+  // the first loader task keeps running till released
+  scheduler.submit(sample_query(0), loader, [&low_started, released] {
+    low_started++;
+    released.wait();
+  });
+  scheduler.submit(sample_query(1), loader, [&low_started] { low_started++; });
+  BOOST_REQUIRE(wait_for([&] { return low_started == 1; }));
+
+  // high priority class keeps running while the second loader task waits
+  for (int i = 0; i < 4; i++) {
+    scheduler.submit(sample_query(i), reader, [&high_done] { high_done++; });
+  }
+  BOOST_REQUIRE(wait_for([&] { return high_done == 4; }));
+  BOOST_TEST(low_started == 1);
+  BOOST_TEST(scheduler.pending() == 1);
+
+  release.set_value();
+  BOOST_TEST(wait_for([&] { return low_started == 2; }));
+  BOOST_TEST(scheduler.pending() == 0);
+
+  work.reset();
+  tg.join_all();
+}
+
+BOOST_AUTO_TEST_CASE(xkdb_buffer_pool) {
+  auto &pool = BufferPool::instance();
+  auto before = pool.stats();
+
+  // a released buffer is cached and handed out again
+  auto sb = pool.acquire();
+  std::string data(10000, 'x');
+  sb->commit(boost::asio::buffer_copy(sb->prepare(data.size()),
+                                      boost::asio::buffer(data)));
+  auto capacity = sb->capacity();
+  pool.release(std::move(sb));
+  auto stats = pool.stats();
+  BOOST_TEST(stats.in_use == before.in_use);
+  BOOST_TEST(stats.idle == before.idle + 1);
+
+  sb = pool.acquire();
+  BOOST_TEST(sb->size() == 0);
+  BOOST_TEST(sb->capacity() == capacity);
+  BOOST_TEST(pool.stats().hits == before.hits + 1);
+
+  // a buffer that outgrew the largest size class is freed
+  sb->prepare(8 << 20);
+  pool.release(std::move(sb));
+  stats = pool.stats();
+  BOOST_TEST(stats.dropped == before.dropped + 1);
+  BOOST_TEST(stats.idle == before.idle);
+  BOOST_TEST(stats.in_use == before.in_use);
+}
+
+BOOST_AUTO_TEST_CASE(xkdb_frame) {
+  auto query = sample_query(1);
+  std::string large(Frame::VIEW_THRESHOLD, 'x');
+  query.mutable_events(0)->set_extra(large);
+  auto event = query.add_events();
+  event->set_id(2);
+  event->set_extra("small");
+
+  Frame frame(query.SerializeAsString());
+  xkdb::Query parsed;
+  BOOST_REQUIRE(frame.parse(parsed));
+  BOOST_TEST(parsed.type() == xkdb::Query::INSERT);
+  BOOST_TEST(parsed.events_size() == 2);
+  BOOST_TEST(parsed.events(0).id() == 1);
+  BOOST_TEST(parsed.events(1).id() == 2);
+
+  // large field is not copied into the message but viewed in the frame
+  BOOST_TEST(parsed.events(0).extra().empty());
+  auto extra = frame.get(parsed.events(0), "extra");
+  BOOST_TEST(extra == large);
+  auto bytes = frame.bytes();
+  BOOST_TEST((extra.data() >= bytes.data() &&
+              extra.data() + extra.size() <= bytes.data() + bytes.size()));
+
+  // small field is parsed as usual
+  BOOST_TEST(parsed.events(1).extra() == "small");
+  BOOST_TEST(frame.get(parsed.events(1), "extra") == "small");
+
+  BOOST_CHECK_THROW(frame.get(parsed.events(1), "id"), std::invalid_argument);
+
+  using Event = std::decay_t<decltype(query.events(0))>;
+  Event small_event, large_event;
+  small_event.set_extra("small");
+  large_event.set_extra(large);
+
+  // a repeated singular field on the wire, the last occurrence wins
+  {
+    Frame frame(large_event.SerializeAsString() +
+                small_event.SerializeAsString());
+    Event parsed;
+    BOOST_REQUIRE(frame.parse(parsed));
+    BOOST_TEST(parsed.extra() == "small");
+    BOOST_TEST(frame.get(parsed, "extra") == "small");
+  }
+  {
+    Frame frame(small_event.SerializeAsString() +
+                large_event.SerializeAsString());
+    Event parsed;
+    BOOST_REQUIRE(frame.parse(parsed));
+    BOOST_TEST(parsed.extra().empty());
+    BOOST_TEST(frame.get(parsed, "extra") == large);
+  }
+  {
+    auto larger = large + "y";
+    large_event.set_extra(larger);
+    Frame frame(large_event.SerializeAsString() +
+                small_event.SerializeAsString() +
+                large_event.SerializeAsString());
+    Event parsed;
+    BOOST_REQUIRE(frame.parse(parsed));
+    BOOST_TEST(parsed.extra().empty());
+    BOOST_TEST(frame.get(parsed, "extra") == larger);
+  }
+
+  // a oneof member replaces another one with all views inside it, xkdb has
+  // no oneof so build `oneof o { Inner a = 1; string b = 2; }` at run time
+  using FieldProto = google::protobuf::FieldDescriptorProto;
+  google::protobuf::FileDescriptorProto file;
+  file.set_name("frame_oneof.proto");
+  file.set_package("frame_test");
+  auto inner_type = file.add_message_type();
+  inner_type->set_name("Inner");
+  auto s_field = inner_type->add_field();
+  s_field->set_name("s");
+  s_field->set_number(1);
+  s_field->set_type(FieldProto::TYPE_STRING);
+  s_field->set_label(FieldProto::LABEL_OPTIONAL);
+  auto outer_type = file.add_message_type();
+  outer_type->set_name("Outer");
+  outer_type->add_oneof_decl()->set_name("o");
+  auto a_field = outer_type->add_field();
+  a_field->set_name("a");
+  a_field->set_number(1);
+  a_field->set_type(FieldProto::TYPE_MESSAGE);
+  a_field->set_type_name(".frame_test.Inner");
+  a_field->set_label(FieldProto::LABEL_OPTIONAL);
+  a_field->set_oneof_index(0);
+  auto b_field = outer_type->add_field();
+  b_field->set_name("b");
+  b_field->set_number(2);
+  b_field->set_type(FieldProto::TYPE_STRING);
+  b_field->set_label(FieldProto::LABEL_OPTIONAL);
+  b_field->set_oneof_index(0);
+
+  google::protobuf::DescriptorPool pool;
+  BOOST_REQUIRE(pool.BuildFile(file));
+  auto outer = pool.FindMessageTypeByName("frame_test.Outer");
+  auto a = outer->FindFieldByName("a");
+  auto b = outer->FindFieldByName("b");
+  auto s = a->message_type()->FindFieldByName("s");
+  google::protobuf::DynamicMessageFactory factory(&pool);
+  auto prototype = factory.GetPrototype(outer);
+  auto refl = prototype->GetReflection();
+
+  std::unique_ptr<Message> with_a(prototype->New()), with_b(prototype->New());
+  auto inner = refl->MutableMessage(with_a.get(), a);
+  inner->GetReflection()->SetString(inner, s, large);
+  refl->SetString(with_b.get(), b, "bee");
+  {
+    Frame frame(with_a->SerializeAsString() + with_b->SerializeAsString());
+    std::unique_ptr<Message> parsed(prototype->New());
+    BOOST_REQUIRE(frame.parse(*parsed));
+    BOOST_TEST(refl->GetOneofFieldDescriptor(*parsed, b->containing_oneof()) ==
+               b);
+    BOOST_TEST(frame.get(*parsed, b) == "bee");
+  }
+  {
+    Frame frame(with_b->SerializeAsString() + with_a->SerializeAsString());
+    std::unique_ptr<Message> parsed(prototype->New());
+    BOOST_REQUIRE(frame.parse(*parsed));
+    BOOST_TEST(refl->GetOneofFieldDescriptor(*parsed, a->containing_oneof()) ==
+               a);
+    BOOST_TEST(frame.get(refl->GetMessage(*parsed, a), s) == large);
+  }
+}
+
+/**
+ *  Server running on its own io threads and a client authenticated to it
+ */
+struct server_fixture {
+  static constexpr int port = 52276;
+
+  ~server_fixture() {
+    client.reset();
+    ioc.stop();
+    tg.join_all();
+  }
+
+  // start server with the given query handle and optional sched_config
+  template <typename... Args> void start(Args &&...args) {
+    server = std::make_unique<Server>(ioc, port, auth_handle,
+                                      std::forward<Args>(args)...);
+    tg.create_thread(boost::bind(&boost::asio::io_context::run, &ioc));
+    tg.create_thread(boost::bind(&boost::asio::io_context::run, &ioc));
+
+    // give time for threads to start
+    boost::this_thread::sleep_for(boost::chrono::milliseconds(100));
+
+    client = std::make_unique<Client>(cioc, "127.0.0.1", port);
+    xkdb::Auth auth;
+    auth.set_user("x-company");
+    auth.set_pass("123592*123");
+    BOOST_REQUIRE(client->exec(auth).status() == xkdb::Response::OK);
+  }
+
+  // send auth and queries in a single write, then read all responses
+  std::vector<xkdb::Response>
+  exec_pipelined(const std::vector<xkdb::Query> &queries) {
+    boost::asio::io_context pioc;
+    tcp::socket socket(pioc);
+    socket.connect(
+        tcp::endpoint(boost::asio::ip::make_address("127.0.0.1"), port));
+
+    DelimitedStream dstream(xkdb::Response::CLIENT_ERROR);
+    xkdb::Response resp;
+    xkdb::Auth auth;
+    auth.set_user("x-company");
+    auth.set_pass("123592*123");
+    dstream.serialize(auth, resp);
+    for (auto &query : queries) {
+      dstream.serialize(query, resp);
+    }
+    boost::asio::write(socket, dstream.obuf());
+
+    std::vector<xkdb::Response> resps(queries.size() + 1);
+    for (auto &r : resps) {
+      auto length = boost::asio::read_until(socket, dstream.ibuf(),
+                                            DelimitedStream::DELIM);
+      dstream.parse(r, r, length);
+    }
+    return resps;
+  }
+
+  boost::asio::io_context ioc;
+  std::unique_ptr<Server> server;
+  boost::thread_group tg;
+  boost::asio::io_context cioc;
+  std::unique_ptr<Client> client;
+};
+
+BOOST_FIXTURE_TEST_CASE(xkdb_server_scheduled, server_fixture) {
+  // the user is a bulk loader: low priority class, one handler at a time
+  x_company::xkdbmes::sched_config config;
+  config.classes = {{0, 0}, {1, 1}};
+  config.by_user["x-company"] = 1;
+  start(query_handle, config);
+
+  // replies are deferred till the scheduler runs the handler
+  for (std::int64_t i = 0; i < 4; i++) {
+    auto resp = client->exec(sample_query(i));
+    BOOST_TEST(resp.status() == xkdb::Response::OK);
+    BOOST_REQUIRE(resp.events_size() == 1);
+    BOOST_TEST(resp.events(0).id() == i);
+  }
+}
+
+BOOST_FIXTURE_TEST_CASE(xkdb_idle_session, server_fixture) {
+  auto &pool = BufferPool::instance();
+  auto before = pool.stats();
+
+  start(query_handle);
+  BOOST_TEST(client->exec(sample_query(1)).status() == xkdb::Response::OK);
+
+  // neither the idle session nor the client holds a buffer, the session
+  // gives it back once the response is written, which may complete after the
+  // client already got it
+  BOOST_TEST(wait_for([&] { return pool.stats().in_use == before.in_use; }));
+}
+
+BOOST_FIXTURE_TEST_CASE(xkdb_server_pipelined, server_fixture) {
+  start(query_handle);
+
+  // every pipelined query gets its own response, in order
+  auto resps = exec_pipelined({sample_query(1), sample_query(2)});
+  BOOST_TEST(resps[0].status() == xkdb::Response::OK);
+  for (std::int64_t i = 1; i <= 2; i++) {
+    BOOST_TEST(resps[i].status() == xkdb::Response::OK);
+    BOOST_REQUIRE(resps[i].events_size() == 1);
+    BOOST_TEST(resps[i].events(0).id() == i);
+  }
+}
+
+BOOST_FIXTURE_TEST_CASE(xkdb_server_frame, server_fixture) {
+  start(frame_query_handle);
+
+  auto query = sample_query(7);
+  std::string large(100000, 'x');
+  query.mutable_events(0)->set_extra(large);
+  auto resp = client->exec(query);
+  BOOST_TEST(resp.status() == xkdb::Response::OK);
+  BOOST_REQUIRE(resp.events_size() == 1);
+  BOOST_TEST(resp.events(0).id() == 7);
+  BOOST_TEST(resp.events(0).extra() == large);
+
+  // small payloads are parsed as usual
+  resp = client->exec(sample_query(8));
+  BOOST_REQUIRE(resp.events_size() == 1);
+  BOOST_TEST(resp.events(0).extra() == sample_query(8).events(0).extra());
+}
+
+BOOST_FIXTURE_TEST_CASE(xkdb_server_frame_pipelined, server_fixture) {
+  start(frame_query_handle);
+
+  // the received buffer goes to the first frame, the rest of the input moves
+  // on to a new one
+  auto query = sample_query(1);
+  std::string large(Frame::VIEW_THRESHOLD * 4, 'x');
+  query.mutable_events(0)->set_extra(large);
+  auto resps = exec_pipelined({query, sample_query(2)});
+  BOOST_TEST(resps[0].status() == xkdb::Response::OK);
+  BOOST_REQUIRE(resps[1].events_size() == 1);
+  BOOST_TEST(resps[1].events(0).id() == 1);
+  BOOST_TEST(resps[1].events(0).extra() == large);
+  BOOST_REQUIRE(resps[2].events_size() == 1);
+  BOOST_TEST(resps[2].events(0).id() == 2);
+  BOOST_TEST(resps[2].events(0).extra() == sample_query(2).events(0).extra());
+}
+
 BOOST_AUTO_TEST_CASE(xkdb_server) {
   GOOGLE_PROTOBUF_VERIFY_VERSION;
 
@@ -18,6 +18,7 @@
 
 #include "../xkdb/common.hpp"
 #include "dstream.hpp"
+#include "scheduler.hpp"
 #include <xkdb.pb.h>
 
 using tcp = boost::asio::ip::tcp;
@@ -31,6 +32,10 @@ class AsynClient;
 using query_handle_t =
     std::function<void(const xkdb::Query &query, xkdb::Response &resp,
                        const connection_info &info)>;
+// query handle that gets large string/bytes fields from `frame`, see `Frame`
+using frame_query_handle_t = std::function<void(
+    const xkdb::Query &query, const Frame &frame, xkdb::Response &resp,
+    const connection_info &info)>;
 using auth_handle_t = std::function<bool(const xkdb::Auth &auth)>;
 using response_handle_t = std::function<void(xkdb::Response &&resp,
                                              std::shared_ptr<AsynClient> self)>;
@@ -136,12 +141,37 @@ public:
   Server(boost::asio::io_context &ioc, uint16_t port, auth_handle_t auth_handle,
          query_handle_t query_handle);
 
+  /**
+   *  \brief Server that passes queries through a priority scheduler instead of
+   * handling them in arrival order
+   *  \param config Priority classes by query type and user
+   */
+  Server(boost::asio::io_context &ioc, uint16_t port, auth_handle_t auth_handle,
+         query_handle_t query_handle, sched_config config);
+
+  /**
+   *  \brief Server whose query handle reads large string/bytes fields as
+   * views into the received frame instead of copies
+   */
+  Server(boost::asio::io_context &ioc, uint16_t port, auth_handle_t auth_handle,
+         frame_query_handle_t query_handle);
+
+  Server(boost::asio::io_context &ioc, uint16_t port, auth_handle_t auth_handle,
+         frame_query_handle_t query_handle, sched_config config);
+
 private:
+  // exactly one of the query handles is set, scheduler is optional
+  Server(boost::asio::io_context &ioc, uint16_t port, auth_handle_t auth_handle,
+         query_handle_t query_handle, frame_query_handle_t frame_query_handle,
+         std::shared_ptr<Scheduler> scheduler);
+
   void do_accept();
 
   tcp::acceptor acceptor_;
   auth_handle_t auth_handle_;
   query_handle_t query_handle_;
+  frame_query_handle_t frame_query_handle_;
+  std::shared_ptr<Scheduler> scheduler_;
 };
 
 /**
@@ -152,15 +182,26 @@ private:
  */
 class Session : public std::enable_shared_from_this<Session> {
 public:
+  /**
+   *  \param query_handle, frame_query_handle Exactly one of them is set
+   *  \param scheduler Scheduler of queries, handle them at once if null
+   */
   Session(tcp::socket socket, auth_handle_t auth_handle,
-          query_handle_t query_handle);
+          query_handle_t query_handle, frame_query_handle_t frame_query_handle,
+          std::shared_ptr<Scheduler> scheduler);
 
   // Start reading/writing messages
   void start() { read_(); }
 
 private:
+  // wait till socket is readable, then receive
   void read_();
+  void receive_();
   void write_();
+  // parse query and pass it to query handle
+  void handle_(size_t length);
+  // serialize response and write it to socket
+  void reply_(xkdb::Response &resp);
 
   tcp::socket socket_;
   bool connected_{false};
@@ -168,6 +209,8 @@ private:
   DelimitedStream dstream_{xkdb::Response::SERVER_ERROR};
   auth_handle_t auth_handle_;
   query_handle_t query_handle_;
+  frame_query_handle_t frame_query_handle_;
+  std::shared_ptr<Scheduler> scheduler_;
 };
 
 } // namespace x_company::xkdbmes